@@ -0,0 +1,447 @@
+/*
+ * Copyright 2018 by Heiko Schäfer <heiko@rangun.de>
+ *
+ * This file is part of huffman.
+ *
+ * huffman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * huffman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with huffman.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "huffbits.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HUFFBITS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using namespace huffman::bits;
+
+#define BUFSIZE 4096u
+
+// codes are put in chunks of at most 56 bits, so that with less than
+// one pending byte in the accumulator the chunk always fits in 64 bits
+#define MAX_CHUNK 56u
+
+uint64_t pack_generic(const uint8_t *src, std::size_t n, const SYMBOL_CODES &sc,
+	std::vector<uint8_t> &out) {
+
+	uint8_t  buf[BUFSIZE + 16u];
+	uint8_t  *p = buf;
+	uint64_t acc = 0u, total = 0u;
+	unsigned fill = 0u;
+
+	for(std::size_t i = 0u; i < n; ++i) {
+
+		uint64_t c = sc.code[src[i]];
+		unsigned l = sc.length[src[i]];
+
+		total += l;
+
+		if(l > MAX_CHUNK) {
+
+			acc |= (c & 0xffffffffu) << fill;
+			fill += 32u;
+
+			for(; fill >= 8u; fill -= 8u, acc >>= 8) *p++ = static_cast<uint8_t>(acc);
+
+			c >>= 32;
+			l -= 32u;
+		}
+
+		acc |= (c & ((UINT64_C(1) << l) - 1u)) << fill;
+		fill += l;
+
+		for(; fill >= 8u; fill -= 8u, acc >>= 8) *p++ = static_cast<uint8_t>(acc);
+
+		if(p >= buf + BUFSIZE) {
+			out.insert(std::end(out), buf, p);
+			p = buf;
+		}
+	}
+
+	if(fill) *p++ = static_cast<uint8_t>(acc);
+
+	out.insert(std::end(out), buf, p);
+
+	return total;
+}
+
+void unpack_generic(const uint8_t *src, std::size_t n, uint8_t *dst) {
+
+	for(std::size_t i = 0u; i < n; ++i) {
+		for(unsigned bit = 0u; bit < 8u; ++bit) {
+			*dst++ = (src[i] >> bit) & 1u;
+		}
+	}
+}
+
+// the last 8 bytes of a stream
+uint64_t window_end(const uint8_t *data, std::size_t nbytes, uint64_t pos) {
+
+	const std::size_t o = pos >> 3;
+	uint64_t w = 0u;
+
+	for(std::size_t k = o; k < nbytes; ++k) w |= static_cast<uint64_t>(data[k]) << ((k - o) * 8u);
+
+	return w >> (pos & 7u);
+}
+
+inline uint64_t window(const uint8_t *data, std::size_t nbytes, uint64_t pos) {
+
+	const std::size_t o = pos >> 3;
+	uint64_t w = 0u;
+
+	if(o + 8u > nbytes) return window_end(data, nbytes, pos);
+
+	for(unsigned k = 0u; k < 8u; ++k) w |= static_cast<uint64_t>(data[o + k]) << (k * 8u);
+
+	return w >> (pos & 7u);
+}
+
+// returns the length of the code at the start of w, 0 if there is none
+unsigned step(const LOOKUP &lt, uint64_t w, char &sym) {
+
+	const uint16_t e = lt.entry[w & ((UINT64_C(1) << lt.bits) - 1u)];
+
+	if(e >> 8) {
+		sym = static_cast<char>(e & 0xffu);
+		return e >> 8;
+	}
+
+	for(const auto &lc : lt.long_codes) {
+		if(!((w ^ lc.code) & ((UINT64_C(1) << lc.length) - 1u))) {
+			sym = static_cast<char>(lc.symbol);
+			return lc.length;
+		}
+	}
+
+	return 0u;
+}
+
+// decodes the rest of s starting at bit pos
+bool tail(const LOOKUP &lt, const STREAM &s, uint64_t pos, char *&o) {
+
+	// locals, as the stores through char * would force reloading the members
+	const uint16_t *entry = lt.entry.data();
+	const uint64_t mask = (UINT64_C(1) << lt.bits) - 1u;
+	const uint64_t end = s.bit_length;
+	const std::size_t nbytes = (end + 7u) / 8u;
+	const uint8_t *data = s.data;
+	char *p = o;
+
+	while(pos < end) {
+
+		const uint64_t w = window(data, nbytes, pos);
+		const uint16_t e = entry[w & mask];
+		unsigned l = e >> 8;
+
+		*p = static_cast<char>(e & 0xffu);
+
+		if(!l && !(l = step(lt, w, *p))) break;
+
+		pos += l;
+		++p;
+	}
+
+	o = p;
+
+	return pos == end;
+}
+
+// room for the most symbols a stream can hold
+char *prepare(const LOOKUP &lt, const STREAM &s, std::vector<char> &out) {
+
+	out.resize(s.bit_length / lt.min_length + 1u);
+
+	return out.data();
+}
+
+bool batch_generic(const LOOKUP &lt, const STREAM *s, std::size_t n, std::vector<char> *out) {
+
+	bool ok = true;
+
+	for(std::size_t i = 0u; i < n; ++i) {
+
+		char *o = prepare(lt, s[i], out[i]);
+
+		ok = tail(lt, s[i], 0u, o) && ok;
+		out[i].resize(o - out[i].data());
+	}
+
+	return ok;
+}
+
+const KERNEL generic = { "generic", pack_generic, unpack_generic, batch_generic };
+
+#ifdef HUFFBITS_X86
+
+__attribute__((target("bmi2")))
+uint64_t pack_bmi2(const uint8_t *src, std::size_t n, const SYMBOL_CODES &sc,
+	std::vector<uint8_t> &out) {
+
+	uint8_t  buf[BUFSIZE + 16u];
+	uint8_t  *p = buf;
+	uint64_t acc = 0u, total = 0u;
+	unsigned fill = 0u;
+
+	for(std::size_t i = 0u; i < n; ++i) {
+
+		uint64_t c = sc.code[src[i]];
+		unsigned l = sc.length[src[i]];
+
+		total += l;
+
+		if(l > MAX_CHUNK) {
+
+			acc |= _bzhi_u64(c, 32u) << fill;
+			fill += 32u;
+
+			std::memcpy(p, &acc, sizeof(acc));
+			p += fill >> 3;
+			acc >>= fill & ~7u;
+			fill &= 7u;
+
+			c >>= 32;
+			l -= 32u;
+		}
+
+		// branchless: store all 8 bytes, advance by the complete ones only
+		acc |= _bzhi_u64(c, l) << fill;
+		fill += l;
+
+		std::memcpy(p, &acc, sizeof(acc));
+		p += fill >> 3;
+		acc >>= fill & ~7u;
+		fill &= 7u;
+
+		if(p >= buf + BUFSIZE) {
+			out.insert(std::end(out), buf, p);
+			p = buf;
+		}
+	}
+
+	if(fill) *p++ = static_cast<uint8_t>(acc);
+
+	out.insert(std::end(out), buf, p);
+
+	return total;
+}
+
+__attribute__((target("bmi2")))
+void unpack_bmi2(const uint8_t *src, std::size_t n, uint8_t *dst) {
+
+	for(std::size_t i = 0u; i < n; ++i, dst += 8u) {
+		const uint64_t w = _pdep_u64(src[i], UINT64_C(0x0101010101010101));
+		std::memcpy(dst, &w, sizeof(w));
+	}
+}
+
+__attribute__((target("avx2")))
+void unpack_avx2(const uint8_t *src, std::size_t n, uint8_t *dst) {
+
+	// byte k of the input goes to output bytes 8k .. 8k+7, which are then
+	// tested against the bit pattern 0x01, 0x02, ..., 0x80
+	const __m256i shuf = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(0x8040201008040201ull));
+	const __m256i one  = _mm256_set1_epi8(1);
+
+	std::size_t i = 0u;
+
+	for(; i + 4u <= n; i += 4u, dst += 32u) {
+
+		uint32_t w;
+		std::memcpy(&w, src + i, sizeof(w));
+
+		__m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(w)), shuf);
+
+		v = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(v, mask), mask), one);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+	}
+
+	unpack_generic(src + i, n - i, dst);
+}
+
+// Four streams are decoded side by side, one per 64 bit lane. As long as every
+// lane is at least 8 bytes away from the end of its stream the windows and the
+// table entries are fetched with gathers; streams are finished with tail() and
+// the lane is refilled with the next stream. Once the streams run out, the
+// remaining lanes are finished in scalar code.
+__attribute__((target("avx2")))
+bool batch_avx2(const LOOKUP &lt, const STREAM *s, std::size_t n, std::vector<char> *out) {
+
+	const __m256i mask  = _mm256_set1_epi64x(static_cast<long long>((UINT64_C(1) << lt.bits) - 1u));
+	const __m256i seven = _mm256_set1_epi64x(7);
+	const __m128i lmask = _mm_set1_epi32(0xff);
+	const __m128i syms  = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1);
+	const int *table = reinterpret_cast<const int *>(lt.entry.data());
+
+	std::size_t lane[4], next = 0u;
+	uint64_t pos[4], limit[4], addr[4];
+	char *o[4];
+	bool busy[4], ok = true;
+
+	auto assign = [&](unsigned l) {
+
+		busy[l] = next < n;
+
+		if(busy[l]) {
+
+			const uint64_t nbytes = (s[next].bit_length + 7u) / 8u;
+
+			lane[l]  = next;
+			pos[l]   = 0u;
+			limit[l] = std::min<uint64_t>(s[next].bit_length, nbytes >= 8u ? (nbytes - 7u) * 8u : 0u);
+			addr[l]  = reinterpret_cast<uintptr_t>(s[next].data);
+			o[l]     = prepare(lt, s[next], out[next]);
+
+			++next;
+		}
+	};
+
+	auto finish = [&](unsigned l) {
+		ok = tail(lt, s[lane[l]], pos[l], o[l]) && ok;
+		out[lane[l]].resize(o[l] - out[lane[l]].data());
+	};
+
+	for(unsigned l = 0u; l < 4u; ++l) assign(l);
+
+	for(;;) {
+
+		bool all = true;
+
+		for(unsigned l = 0u; l < 4u; ++l) {
+
+			while(busy[l] && pos[l] >= limit[l]) {
+				finish(l);
+				assign(l);
+			}
+
+			all = all && busy[l];
+		}
+
+		if(!all) break;
+
+		__m256i vpos = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+		const __m256i vlim  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(limit));
+		const __m256i vaddr = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(addr));
+
+		bool slow = false;
+
+		while(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vlim, vpos))) == 0xf) {
+
+			__m256i w = _mm256_i64gather_epi64(static_cast<const long long *>(0),
+				_mm256_add_epi64(vaddr, _mm256_srli_epi64(vpos, 3)), 1);
+
+			w = _mm256_srlv_epi64(w, _mm256_and_si256(vpos, seven));
+
+			const __m128i e   = _mm256_i64gather_epi32(table, _mm256_and_si256(w, mask), 2);
+			const __m128i len = _mm_and_si128(_mm_srli_epi32(e, 8), lmask);
+
+			// a long code (or garbage) in at least one lane
+			if(!_mm_testz_si128(_mm_cmpeq_epi32(len, _mm_setzero_si128()),
+				_mm_set1_epi32(-1))) {
+				slow = true;
+				break;
+			}
+
+			const uint32_t sym = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_shuffle_epi8(e, syms)));
+
+			*o[0]++ = static_cast<char>(sym);
+			*o[1]++ = static_cast<char>(sym >> 8);
+			*o[2]++ = static_cast<char>(sym >> 16);
+			*o[3]++ = static_cast<char>(sym >> 24);
+
+			vpos = _mm256_add_epi64(vpos, _mm256_cvtepu32_epi64(len));
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pos), vpos);
+
+		if(slow) {
+			for(unsigned l = 0u; l < 4u; ++l) {
+
+				const STREAM &st = s[lane[l]];
+				const unsigned c = step(lt, window(st.data, (st.bit_length + 7u) / 8u, pos[l]),
+					*o[l]);
+
+				// let tail() run into the invalid code again and report it
+				if(!c) {
+					limit[l] = pos[l];
+				} else {
+					pos[l] += c;
+					++o[l];
+				}
+			}
+		}
+	}
+
+	for(unsigned l = 0u; l < 4u; ++l) {
+		if(busy[l]) finish(l);
+	}
+
+	return ok;
+}
+
+const KERNEL bmi2 = { "bmi2", pack_bmi2, unpack_bmi2, batch_generic };
+const KERNEL avx2 = { "avx2", pack_bmi2, unpack_avx2, batch_avx2 };
+const KERNEL avx2_nobmi2 = { "avx2", pack_generic, unpack_avx2, batch_avx2 };
+
+#endif
+
+const KERNEL *named_kernel(const char *name) {
+
+	if(!std::strcmp(name, "generic")) return &generic;
+
+#ifdef HUFFBITS_X86
+	__builtin_cpu_init();
+
+	const bool has_bmi2 = __builtin_cpu_supports("bmi2");
+	const bool has_avx2 = __builtin_cpu_supports("avx2");
+
+	if(!std::strcmp(name, "bmi2")) return has_bmi2 ? &bmi2 : 0L;
+	if(!std::strcmp(name, "avx2")) return has_avx2 ? (has_bmi2 ? &avx2 : &avx2_nobmi2) : 0L;
+#endif
+
+	return 0L;
+}
+
+const KERNEL &select_kernel() {
+
+	const char *force = std::getenv("HUFFMAN_KERNEL");
+	const KERNEL *k = force ? named_kernel(force) : 0L;
+
+	if(!k) k = named_kernel("avx2");
+	if(!k) k = named_kernel("bmi2");
+
+	return k ? *k : generic;
+}
+
+}
+
+const KERNEL &huffman::bits::kernel() {
+
+	static const KERNEL &k(select_kernel());
+
+	return k;
+}
+
+const KERNEL *huffman::bits::kernel(const char *name) {
+	return named_kernel(name);
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright 2018 by Heiko Schäfer <heiko@rangun.de>
+ *
+ * This file is part of huffman.
+ *
+ * huffman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * huffman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with huffman.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HUFFBITS_H
+#define _HUFFBITS_H
+
+#include <type_traits>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace huffman {
+
+namespace bits {
+
+// per byte symbol: code bits (LSB first, as in DICT_KEY::bcode) and code length
+typedef struct {
+	uint64_t code[256];
+	uint8_t  length[256];
+} SYMBOL_CODES;
+
+// packs the codes of n symbols into out (LSB first), returns the number of bits written
+typedef uint64_t (*PACK_FN)(const uint8_t *src, std::size_t n, const SYMBOL_CODES &sc,
+	std::vector<uint8_t> &out);
+
+// expands n bytes into 8 * n bytes of value 0 or 1 (LSB first)
+typedef void (*UNPACK_FN)(const uint8_t *src, std::size_t n, uint8_t *dst);
+
+// index width of the decoding lookup table, longer codes are matched one by one
+constexpr unsigned LOOKUP_BITS = 12u;
+
+// codes must fit into a single unaligned 64 bit load of the stream
+constexpr unsigned LOOKUP_MAX_LENGTH = 56u;
+
+typedef struct {
+	uint8_t  length;
+	uint8_t  symbol; // or its index, see batch_decoder
+	uint64_t code;
+} LONG_CODE;
+
+typedef struct {
+	unsigned bits;
+	unsigned min_length;
+	std::vector<uint16_t>  entry; // (length << 8) | symbol, length 0 for long codes
+	std::vector<LONG_CODE> long_codes;
+} LOOKUP;
+
+// a packed stream as written by huffenc, data holds (bit_length + 7) / 8 bytes
+typedef struct {
+	const uint8_t *data;
+	uint64_t bit_length;
+} STREAM;
+
+// decodes n streams sharing one table into out[0] .. out[n - 1],
+// returns false if any of them is not a valid sequence of codes
+typedef bool (*BATCH_FN)(const LOOKUP &lt, const STREAM *s, std::size_t n,
+	std::vector<char> *out);
+
+typedef struct {
+	const char *name;
+	PACK_FN     pack;
+	UNPACK_FN   unpack;
+	BATCH_FN    batch;
+} KERNEL;
+
+// best kernel for the running CPU, selected once via CPUID
+// (may be overridden by setting HUFFMAN_KERNEL to "generic", "bmi2" or "avx2")
+const KERNEL &kernel();
+
+// the kernel of that name, if the running CPU supports it
+const KERNEL *kernel(const char *name);
+
+// the codes of a dictionary of one byte symbols
+template<class Dict>
+SYMBOL_CODES symbol_codes(const Dict &d) {
+
+	static_assert(sizeof(typename Dict::mapped_type) == 1u, "symbol_codes() needs one byte symbols");
+
+	SYMBOL_CODES sc = {};
+
+	for(const auto &e : d) {
+		sc.code[static_cast<uint8_t>(e.second)]   = e.first.bcode;
+		sc.length[static_cast<uint8_t>(e.second)] = e.first.length;
+	}
+
+	return sc;
+}
+
+// builds the decoding table, fails for codes of length 0 or above LOOKUP_MAX_LENGTH,
+// codes with bits beyond their length and codes which are not prefix free;
+// index maps a symbol to the byte the kernels put out for it
+template<class Dict, class Index>
+bool lookup_table(const Dict &d, LOOKUP &lt, Index index) {
+
+	unsigned maxlen = 0u, minlen = 64u;
+
+	for(const auto &e : d) {
+		maxlen = std::max<unsigned>(maxlen, e.first.length);
+		minlen = std::min<unsigned>(minlen, e.first.length);
+	}
+
+	if(d.empty() || !minlen || maxlen > LOOKUP_MAX_LENGTH) return false;
+
+	lt.bits = std::min(maxlen, LOOKUP_BITS);
+	lt.min_length = minlen;
+
+	// one spare entry, as the table is gathered with 32 bit loads
+	lt.entry.assign((std::size_t(1u) << lt.bits) + 1u, 0u);
+	lt.long_codes.clear();
+
+	for(const auto &e : d) {
+
+		const unsigned len = e.first.length;
+
+		if(e.first.bcode >> len) return false;
+
+		if(len > lt.bits) {
+			lt.long_codes.push_back(LONG_CODE { e.first.length, index(e.second), e.first.bcode });
+			continue;
+		}
+
+		for(uint64_t hi = 0u; hi < (UINT64_C(1) << (lt.bits - len)); ++hi) {
+
+			uint16_t &slot(lt.entry[e.first.bcode | (hi << len)]);
+
+			if(slot) return false;
+
+			slot = static_cast<uint16_t>((len << 8) | index(e.second));
+		}
+	}
+
+	// long codes must neither start with a short one nor with each other
+	for(auto i = std::begin(lt.long_codes); i != std::end(lt.long_codes); ++i) {
+
+		if(lt.entry[i->code & ((UINT64_C(1) << lt.bits) - 1u)]) return false;
+
+		for(auto j = std::begin(lt.long_codes); j != i; ++j) {
+
+			const unsigned l = std::min(i->length, j->length);
+
+			if(!((i->code ^ j->code) & ((UINT64_C(1) << l) - 1u))) return false;
+		}
+	}
+
+	return true;
+}
+
+template<class Dict>
+bool lookup_table(const Dict &d, LOOKUP &lt) {
+	return lookup_table(d, lt, [](const typename Dict::mapped_type &c) {
+		return static_cast<uint8_t>(c); });
+}
+
+// Batched decoding of streams sharing one table of huffman<CharType, ...>::DICT.
+// One byte symbols are put out directly, wider ones by their index into the
+// table, so it works for alphabets of at most 256 symbols.
+template<class CharType>
+class batch_decoder {
+
+	batch_decoder(const batch_decoder&);
+	batch_decoder& operator=(const batch_decoder&);
+
+public:
+	template<class Dict>
+	explicit batch_decoder(const Dict &d, const KERNEL &k = kernel()) : m_kernel(k), m_lt(),
+		m_symbols(), m_valid(build(d)) {}
+
+	// false if the table cannot be decoded this way, use huffman::decode then
+	bool valid() const {
+		return m_valid;
+	}
+
+	// decodes n streams into out[0] .. out[n - 1], false if any of them is invalid
+	template<class C = CharType>
+	typename std::enable_if<std::is_same<C, char>::value, bool>::type
+	decode(const STREAM *s, std::size_t n, std::vector<C> *out) const {
+		return m_valid && m_kernel.batch(m_lt, s, n, out);
+	}
+
+	template<class C = CharType>
+	typename std::enable_if<!std::is_same<C, char>::value, bool>::type
+	decode(const STREAM *s, std::size_t n, std::vector<C> *out) const {
+
+		if(!m_valid) return false;
+
+		std::vector<std::vector<char>> idx(n);
+		const bool ok = m_kernel.batch(m_lt, s, n, idx.data());
+
+		for(std::size_t i = 0u; i < n; ++i) {
+
+			out[i].clear();
+			out[i].reserve(idx[i].size());
+
+			for(const auto &c : idx[i]) out[i].push_back(m_symbols[static_cast<uint8_t>(c)]);
+		}
+
+		return ok;
+	}
+
+private:
+	template<class Dict>
+	bool build(const Dict &d) {
+
+		if(sizeof(CharType) == 1u) {
+
+			for(unsigned i = 0u; i < 256u; ++i) {
+				m_symbols.push_back(static_cast<CharType>(static_cast<uint8_t>(i)));
+			}
+
+			return lookup_table(d, m_lt);
+		}
+
+		if(d.size() > 256u) return false;
+
+		for(const auto &e : d) m_symbols.push_back(e.second);
+
+		return lookup_table(d, m_lt, [this](const CharType &c) {
+			return static_cast<uint8_t>(std::find(std::begin(m_symbols), std::end(m_symbols), c) -
+				std::begin(m_symbols)); });
+	}
+
+private:
+	const KERNEL &m_kernel;
+	LOOKUP m_lt;
+	std::vector<CharType> m_symbols;
+	const bool m_valid;
+};
+
+}
+
+}
+
+#endif /* _HUFFBITS_H */
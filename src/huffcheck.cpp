@@ -0,0 +1,269 @@
+/*
+ * Copyright 2018 by Heiko Schäfer <heiko@rangun.de>
+ *
+ * This file is part of huffman.
+ *
+ * huffman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * huffman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with huffman.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <random>
+
+#include "hufflib.h"
+#include "huffbits.h"
+
+#define STREAMS 37u
+
+using namespace huffman::bits;
+
+static bool check(const std::string &what, bool ok) {
+
+	if(!ok) std::cerr << "FAILED: " << what << std::endl;
+
+	return ok;
+}
+
+// fibonacci weights give codes well beyond LOOKUP_BITS
+static std::vector<double> weights(std::size_t n) {
+
+	std::vector<double> w(n, 1.0);
+
+	for(std::size_t i = 2u; i < n; ++i) w[i] = w[i - 1u] + w[i - 2u];
+
+	return w;
+}
+
+static STREAM pack(const std::vector<bool> &code, std::vector<uint8_t> &buf) {
+
+	buf.assign((code.size() + 7u) / 8u, 0u);
+
+	for(std::size_t i = 0u; i < code.size(); ++i) {
+		if(code[i]) buf[i >> 3] |= 1u << (i & 7u);
+	}
+
+	return STREAM { buf.data(), code.size() };
+}
+
+// codes of every length from 1 to 64 bits, enough of them to flush the kernels' buffers
+static bool check_pack(const KERNEL &k, const std::string &name) {
+
+	std::mt19937_64 rnd(42u);
+	SYMBOL_CODES sc = {};
+
+	for(unsigned i = 0u; i < 256u; ++i) {
+
+		sc.length[i] = static_cast<uint8_t>(1u + i % 64u);
+		sc.code[i] = rnd() >> (64u - sc.length[i]);
+	}
+
+	std::vector<uint8_t> src(5000u), out, ref;
+	std::vector<bool> code;
+
+	for(auto &c : src) {
+
+		c = static_cast<uint8_t>(rnd());
+
+		for(unsigned b = 0u; b < sc.length[c]; ++b) code.push_back((sc.code[c] >> b) & 1u);
+	}
+
+	pack(code, ref);
+
+	bool ok = check(name + ": pack length", k.pack(src.data(), src.size(), sc, out) == code.size());
+	ok = check(name + ": pack", out == ref) && ok;
+
+	// an odd number of bytes, so that the vector kernels have a remainder
+	std::vector<uint8_t> bits(8u * (src.size() - 1u), 0xffu);
+
+	k.unpack(src.data(), src.size() - 1u, bits.data());
+
+	for(std::size_t i = 0u; i < bits.size(); ++i) {
+		if(bits[i] != ((src[i >> 3] >> (i & 7u)) & 1u)) return check(name + ": unpack", false);
+	}
+
+	return ok;
+}
+
+template<class CharType>
+static bool check_kernel(const KERNEL &k, const std::string &name) {
+
+	typedef huffman::huffman<CharType, double> CODEC;
+
+	const std::vector<double> w(weights(26u));
+	typename CODEC::ALPHABET alpha;
+
+	for(std::size_t i = 0u; i < w.size(); ++i) {
+		alpha.emplace_back(typename CODEC::ALPHABET_ENTRY(static_cast<CharType>('A' + i), w[i]));
+	}
+
+	const CODEC huff(alpha);
+
+	std::mt19937 rnd(42u);
+	std::vector<std::vector<CharType>> src(STREAMS);
+	std::vector<std::vector<uint8_t>> buf(STREAMS);
+	std::vector<STREAM> st;
+
+	// uniform picks, so that the rare symbols with long codes show up often
+	for(std::size_t i = 0u; i < STREAMS; ++i) {
+
+		for(std::size_t j = i ? rnd() % 200u : 0u; j > 0u; --j) {
+			src[i].push_back(static_cast<CharType>('A' + rnd() % w.size()));
+		}
+
+		// the last stream ends with one of the longest codes
+		if(i + 1u == STREAMS) src[i].push_back(static_cast<CharType>('A'));
+
+		st.push_back(pack(huff.encode(std::begin(src[i]), std::end(src[i])), buf[i]));
+	}
+
+	const batch_decoder<CharType> dec(huff.dictionary(), k);
+	std::vector<std::vector<CharType>> out(STREAMS);
+	bool ok = check(name + ": table", dec.valid());
+
+	if(!ok) return ok;
+
+	ok = check(name + ": batch", dec.decode(st.data(), st.size(), out.data())) && ok;
+
+	for(std::size_t i = 0u; i < STREAMS; ++i) {
+		ok = check(name + ": stream " + std::to_string(i), out[i] == src[i]) && ok;
+	}
+
+	// a stream ending within its last code
+	--st.back().bit_length;
+	ok = check(name + ": truncated", !dec.decode(st.data(), st.size(), out.data())) && ok;
+
+	return ok;
+}
+
+// counts the blocks it hands out, copies of a huffman count on a counter of their own
+template<class T>
+struct counting_allocator {
+
+	typedef T value_type;
+
+	counting_allocator(long *l, long *c) : live(l), copies(c) {}
+
+	template<class U>
+	counting_allocator(const counting_allocator<U> &o) : live(o.live), copies(o.copies) {}
+
+	T *allocate(std::size_t n) {
+		++*live;
+		return static_cast<T *>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T *p, std::size_t) {
+		--*live;
+		::operator delete(p);
+	}
+
+	counting_allocator select_on_container_copy_construction() const {
+		return counting_allocator(copies, copies);
+	}
+
+	long *live, *copies;
+};
+
+template<class T, class U>
+bool operator==(const counting_allocator<T> &a, const counting_allocator<U> &b) {
+	return a.live == b.live;
+}
+
+template<class T, class U>
+bool operator!=(const counting_allocator<T> &a, const counting_allocator<U> &b) {
+	return !(a == b);
+}
+
+static bool check_allocator() {
+
+	typedef counting_allocator<char> ALLOC;
+	typedef huffman::huffman<char, double, std::vector<bool, counting_allocator<bool>>, ALLOC> CODEC;
+
+	const std::string text("THEQUICKBROWNFOXJUMPSOVERTHELAZYDOG");
+	long live = 0, copies = 0;
+	bool ok = true;
+
+	{
+		const ALLOC al(&live, &copies);
+		const std::vector<double> w(weights(26u));
+		CODEC::ALPHABET alpha(al);
+
+		for(std::size_t i = 0u; i < w.size(); ++i) {
+			alpha.emplace_back(CODEC::ALPHABET_ENTRY(static_cast<char>('A' + i), w[i]));
+		}
+
+		const CODEC huff(alpha, al);
+		const CODEC::CODE code(huff.encode(std::begin(text), std::end(text)));
+		const long before = live;
+
+		const CODEC copy(huff);
+
+		ok = check("allocator: copy", copies > 0 && live == before) && ok;
+
+		const CODEC table(huff.dictionary(), al);
+
+		for(const CODEC *c : { &huff, &copy, &table }) {
+
+			const CODEC::CSEQ dec(c->decode(std::begin(code), std::end(code), code.size()));
+
+			ok = check("allocator: decode", std::string(std::begin(dec), std::end(dec)) == text) &&
+				ok;
+		}
+
+		ok = check("allocator: used", live > 0) && ok;
+	}
+
+	ok = check("allocator: leaks", !live && !copies) && ok;
+
+	return ok;
+}
+
+static bool check_reject() {
+
+	HUFFMAN::DICT d;
+	LOOKUP lt;
+
+	d[HUFFMAN::DICT_KEY { 1u, 0u }] = 'a';
+	d[HUFFMAN::DICT_KEY { 1u, 0xffu }] = 'b';
+
+	bool ok = check("code beyond its length", !lookup_table(d, lt));
+
+	d.clear();
+	d[HUFFMAN::DICT_KEY { 1u, 0u }] = 'a';
+	d[HUFFMAN::DICT_KEY { 20u, 0u }] = 'b';
+
+	ok = check("not prefix free", !lookup_table(d, lt)) && ok;
+
+	return ok;
+}
+
+int main(int, char **) {
+
+	bool ok = check_reject();
+
+	ok = check_allocator() && ok;
+
+	for(const char *name : { "generic", "bmi2", "avx2" }) {
+
+		const KERNEL *k = kernel(name);
+
+		if(k) {
+			ok = check_pack(*k, name) && ok;
+			ok = check_kernel<char>(*k, std::string(name) + " char") && ok;
+			ok = check_kernel<uint16_t>(*k, std::string(name) + " uint16_t") && ok;
+		} else {
+			std::cerr << "skipped: " << name << " (not supported)" << std::endl;
+		}
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -18,62 +18,79 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <memory>
 
 #include "hufflib.h"
+#include "huffbits.h"
 
 int main(int, char **) {
 
-	huffman::HEADER header;
+	std::unique_ptr<const HUFFMAN> huff;
+	std::size_t segments = 0u;
+
+	std::unique_ptr<const huffman::bits::batch_decoder<char>> table;
 
-	std::cin.read(reinterpret_cast<char *>(&header), sizeof(huffman::HEADER));
+	huffman::HEADER header;
+	HUFFMAN::DICT d;
 
-	if(header.version == HUFFVER) {
+	std::vector<char> packed;
+	HUFFMAN::CSEQ source;
 
-		HUFFMAN::DICT d;
+	// the input has to end right after a segment, anything else is corrupt
+	while(std::cin.peek() != EOF) {
 
-		for(uint32_t i = 0u; i < header.dict_entries; ++i) {
+		if(!huffman::huffreadtable(std::cin, header, d)) return EXIT_FAILURE;
 
-			uint8_t  cl = 0u;
-			uint8_t  ch = 0u;
-			uint64_t co = 0u;
+		if(header.version == HUFFVER_SINGLE && segments) return EXIT_FAILURE;
 
-			std::cin.read(reinterpret_cast<char *>(&ch), sizeof(uint8_t));
-			std::cin.read(reinterpret_cast<char *>(&cl), sizeof(uint8_t));
+		if(header.dict_entries) {
+			huff.reset(new HUFFMAN(d));
+			table.reset(new huffman::bits::batch_decoder<char>(huff->dictionary()));
+		} else if(!huff) {
 
-			if(header.dict_entry_size < 25u) {
-				std::cin.read(reinterpret_cast<char *>(&co), sizeof(uint8_t));
-			} else if(header.dict_entry_size < 33u) {
-				std::cin.read(reinterpret_cast<char *>(&co), sizeof(uint16_t));
-			} else if(header.dict_entry_size < 49u) {
-				std::cin.read(reinterpret_cast<char *>(&co), sizeof(uint32_t));
-			} else {
-				std::cin.read(reinterpret_cast<char *>(&co), sizeof(uint64_t));
-			}
+			if(header.bit_length) return EXIT_FAILURE;
 
-			d[HUFFMAN::DICT_KEY {cl, co}] = ch;
+			++segments;
+			continue;
 		}
 
-		char ic;
-		HUFFMAN::CSEQ source;
+		if(!huffman::huffreaddata(std::cin, header, packed)) return EXIT_FAILURE;
 
-		while(!std::cin.read(&ic, 1).eof()) {
-			for(uint8_t bit = 0u; bit < 8u; ++bit) {
-				source.emplace_back(static_cast<uint8_t>(ic) & 1u << bit ? true : false);
-			}
-		}
+		if(table->valid()) {
+
+			const huffman::bits::STREAM st = { reinterpret_cast<const uint8_t *>(packed.data()),
+				header.bit_length };
+
+			if(!table->decode(&st, 1u, &source)) return EXIT_FAILURE;
+
+			std::cout.write(source.data(), source.size());
 
-		const HUFFMAN huff(d);
-		const HUFFMAN::CSEQ dec(huff.decode(std::begin(source), std::end(source),
-			header.bit_length));
+		} else {
 
-		for(const auto &di : dec) {
-			std::cout.put(di);
+			const HUFFMAN::DICT hd(huff->dictionary());
+
+			// only codes too long for the table are decoded bit by bit, other tables are corrupt
+			if(std::none_of(std::begin(hd), std::end(hd), [](const HUFFMAN::DICT::value_type &e) {
+				return e.first.length > huffman::bits::LOOKUP_MAX_LENGTH; })) return EXIT_FAILURE;
+
+			source.resize(packed.size() * 8u);
+
+			huffman::bits::kernel().unpack(reinterpret_cast<const uint8_t *>(packed.data()),
+				packed.size(), reinterpret_cast<uint8_t *>(source.data()));
+
+			const HUFFMAN::CSEQ dec(huff->decode(std::begin(source), std::end(source),
+				header.bit_length));
+
+			std::cout.write(dec.data(), dec.size());
 		}
 
-		std::cout.flush();
+		++segments;
 
-		return EXIT_SUCCESS;
+		if(header.version == HUFFVER_SINGLE) break;
 	}
 
-	return EXIT_FAILURE;
+	std::cout.flush();
+
+	return segments ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -19,87 +19,180 @@
 
 #include <iostream>
 #include <iterator>
+#include <cstring>
+#include <iomanip>
+#include <cmath>
+#include <map>
 
 #include "hufflib.h"
 
-static std::string nodeLabel(const HUFFMAN::TREE * const n) {
+#define MAX_SHOWN 56u
 
-	std::ostringstream os, hex, nor;
+static std::ostream &nodeLabel(std::ostream &os, const HUFFMAN::TREE * const n) {
 
 	if(n->leaf()) {
-		hex << "0x" << std::hex << (((uint16_t)n->name()) & 0xff);
-		nor << "\'" << (n->name() == '\"' ? "\\\"" : std::string(1, n->name())) << "\'";
-		os << " [label=\"" << (std::isprint(n->name()) ? nor.str() : hex.str())
-			<< " (" << std::defaultfloat << n->probability()
-				<< ")\",shape=ellipse,style=filled,fillcolor=darkolivegreen,fontcolor=beige]";
+
+		os << " [label=\"";
+
+		if(std::isprint(n->name())) {
+			os << "\'" << (n->name() == '\"' ? "\\\"" : std::string(1, n->name())) << "\'";
+		} else {
+			os << "0x" << std::hex << (((uint16_t)n->name()) & 0xff);
+		}
+
+		os << std::dec << " (" << std::defaultfloat << n->probability()
+			<< ")\",shape=ellipse,style=filled,fillcolor=darkolivegreen,fontcolor=beige]";
+
 	} else {
-		os << " [label=\"" << std::defaultfloat << n->probability()
+		os << " [label=\"" << std::dec << std::defaultfloat << n->probability()
 			<< "\",shape=box,style=filled,fillcolor=beige,fontcolor=darkolivegreen]";
 	}
 
-	return os.str();
+	return os;
 }
 
-static void tree2dot(const HUFFMAN::TREE * const n, const std::string &l) {
+static void tree2dot(std::ostream &os, const HUFFMAN::TREE * const root) {
+
+	typedef struct {
+		const HUFFMAN::TREE *parent;
+		const HUFFMAN::TREE *node;
+		std::size_t depth;
+	} EDGE;
+
+	std::vector<EDGE> stack;
+	std::string code;
+
+	if(root->right()) stack.push_back(EDGE { root, root->right(), 1u });
+	if(root->left())  stack.push_back(EDGE { root, root->left(),  1u });
+
+	while(!stack.empty()) {
+
+		const EDGE e(stack.back());
+		const bool right = e.node == e.parent->right();
 
-	if(n->left()) {
-		std::cout << "\tN" << std::hex << n->left() << nodeLabel(n->left()) << ";" << std::endl;
-		std::cout << "\tN" << std::hex << n << " -> " << "N" << n->left()
-			<< "[label=\"" << (l + "0") << "\",fontcolor=red,labeldistance=3];" << std::endl;
-		tree2dot(n->left(), l + "0");
+		stack.pop_back();
+
+		code.resize(e.depth - 1u);
+		code.push_back(right ? '1' : '0');
+
+		os << "\tN" << std::hex << e.node;
+		nodeLabel(os, e.node) << ";\n";
+		os << "\tN" << std::hex << e.parent << " -> " << "N" << e.node
+			<< "[label=\"" << code << (right ? "\",fontcolor=blue" : "\",fontcolor=red")
+			<< ",labeldistance=3];\n";
+
+		if(e.node->right()) stack.push_back(EDGE { e.node, e.node->right(), e.depth + 1u });
+		if(e.node->left())  stack.push_back(EDGE { e.node, e.node->left(),  e.depth + 1u });
 	}
+}
+
+static std::size_t height(const HUFFMAN &huff) {
+	return huff.tree() ? huff.tree()->height() : 0u;
+}
+
+static void summary(std::ostream &os, const HUFFMAN &huff, const HUFFMAN::CSEQ &source) {
+
+	std::size_t count[256] = {};
+
+	for(const auto &c : source) ++count[static_cast<uint8_t>(c)];
 
-	if(n->right()) {
-		std::cout << "\tN" << std::hex << n->right() << nodeLabel(n->right()) << ";" << std::endl;
-		std::cout << "\tN" << std::hex << n << " -> " << "N" << n->right()
-			<< "[label=\"" << (l + "1") << "\",fontcolor=blue,labeldistance=3];" << std::endl;
-		tree2dot(n->right(), l + "1");
+	std::map<std::size_t, std::size_t> hist;
+	double kraft = 0.0, entropy = 0.0, avg = 0.0;
+
+	for(const auto &e : huff.dictionary()) {
+
+		if(source.empty()) break;
+
+		const double p = static_cast<double>(count[static_cast<uint8_t>(e.second)]) /
+			static_cast<double>(source.size());
+
+		++hist[e.first.length];
+
+		kraft   += std::ldexp(1.0, -static_cast<int>(e.first.length));
+		entropy -= p > 0.0 ? p * std::log2(p) : 0.0;
+		avg     += p * e.first.length;
+	}
+
+	os << "symbols:        " << huff.dictionary().size() << "\n"
+		<< "input bytes:    " << source.size() << "\n"
+		<< "tree height:    " << height(huff) << "\n"
+		<< "kraft sum:      " << std::defaultfloat << kraft << "\n"
+		<< "entropy:        " << std::fixed << std::setprecision(4) << entropy << " bits/symbol\n"
+		<< "average code:   " << avg << " bits/symbol\n"
+		<< "redundancy:     " << (avg - entropy) << " bits/symbol\n\n"
+		<< "length  codes\n";
+
+	for(const auto &h : hist) {
+		os << std::setw(6) << h.first << "  " << h.second << "\n";
 	}
 }
 
 int main(int argc, const char **argv) {
 
+	std::ios_base::sync_with_stdio(false);
+
+	const char *fname = "";
+	bool sum = false;
+
+	for(int i = 1; i < argc; ++i) {
+		if(!std::strcmp(argv[i], "--summary")) {
+			sum = true;
+		} else {
+			fname = argv[i];
+		}
+	}
+
 	HUFFMAN::CSEQ source;
 
-	const HUFFMAN huff(huffman::huffread(source, argc == 2 ? argv[1] : "",
-		argc == 2 && argv[1][0] != '-', 56u));
+	const HUFFMAN huff(huffman::huffread(source, fname, *fname && *fname != '-', MAX_SHOWN));
+
+	if(sum) {
+		summary(std::cout, huff, source);
+		std::cout.flush();
+		return EXIT_SUCCESS;
+	}
+
+	const auto shown(std::begin(source) + std::min<std::size_t>(source.size(), MAX_SHOWN));
 
-	const bool binary = std::find_if(std::begin(source), std::end(source),
-		[](const HUFFMAN::CSEQ::value_type &x) { return !std::isprint(x); }) != std::end(source);
+	const bool binary = std::find_if(std::begin(source), shown,
+		[](const HUFFMAN::CSEQ::value_type &x) { return !std::isprint(x); }) != shown;
 
 	std::cout << "/* Huffman-tree for: ";
 
 	if(!binary) {
 		std::cout << "\"";
-		std::copy(std::begin(source), std::end(source),
+		std::copy(std::begin(source), shown,
 			std::ostream_iterator<HUFFMAN::character_type>(std::cout));
 		std::cout << "\"";
 	} else {
 		std::cout << "binary input";
 	}
 
-	std::cout << " */" << std::endl
-		<< "/* Generated by huffdot (" << PACKAGE_STRING << ", " << PACKAGE_URL << ") */"
-		<< std::endl << std::endl;
-	std::cout << "digraph hufftree {" << std::endl;
-	std::cout << "\tfontname=\"Courier\";" << std::endl << "\tfontnames=\"ps\";" << std::endl
-		<< "\trank=same;" << std::endl << "\trankdir=RL;" << std::endl << "\tcenter=true;"
-		<< std::endl << "\tsplines=false;" << std::endl << "\tlabel=\"Huffman-tree for: ";
+	std::cout << " */\n"
+		<< "/* Generated by huffdot (" << PACKAGE_STRING << ", " << PACKAGE_URL << ") */\n\n";
+	std::cout << "digraph hufftree {\n";
+	std::cout << "\tfontname=\"Courier\";\n" << "\tfontnames=\"ps\";\n"
+		<< "\trank=same;\n" << "\trankdir=RL;\n" << "\tcenter=true;\n"
+		<< "\tsplines=false;\n" << "\tlabel=\"Huffman-tree for: ";
 
 	if(!binary) {
 		std::cout << "\\\"";
-		std::copy(std::begin(source), std::end(source),
+		std::copy(std::begin(source), shown,
 			std::ostream_iterator<HUFFMAN::character_type>(std::cout));
 		std::cout << "\\\"";
 	} else {
 		std::cout << "binary input";
 	}
 
-	std::cout << (source.size() > 55u ? "..." : "") <<  "\\nmax. # of bits: "
-		<< huff.tree()->height() << "\"" << std::endl;
-	std::cout << std::endl << "\tN" << std::hex << huff.tree() << nodeLabel(huff.tree()) << ";"
-		<< std::endl;
-	tree2dot(huff.tree(), "");
+	std::cout << (source.size() > MAX_SHOWN ? "..." : "") <<  "\\nmax. # of bits: "
+		<< height(huff) << "\"\n";
+
+	if(huff.tree()) {
+		std::cout << "\n\tN" << std::hex << huff.tree();
+		nodeLabel(std::cout, huff.tree()) << ";\n";
+		tree2dot(std::cout, huff.tree());
+	}
+
 	std::cout << "}" << std::endl;
 
 	return EXIT_SUCCESS;
@@ -18,66 +18,192 @@
  */
 
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cmath>
 
 #include "hufflib.h"
+#include "huffbits.h"
 
-int main(int argc, char **argv) {
+// a fresh table must be cheaper by more than this percentage to replace the current one
+#define REUSE_SLACK 2u
 
-	HUFFMAN::CSEQ source;
+static uint64_t cost(const std::size_t *count, const HUFFMAN::DICT &dict) {
 
-	const HUFFMAN huff(huffman::huffread(source, argc == 2 ? argv[1] : "",
-		argc == 2 && argv[1][0] != '-'));
+	bool known[256] = {};
+	uint8_t len[256] = {};
+	uint64_t bits = 0u;
 
-	HUFFMAN::CODE enc(huff.encode(std::begin(source), std::end(source)));
-	huffman::HEADER header;
+	for(const auto &e : dict) {
+		known[static_cast<uint8_t>(e.second)] = true;
+		len[static_cast<uint8_t>(e.second)] = e.first.length;
+	}
+
+	for(std::size_t i = 0u; i < 256u; ++i) {
+
+		if(count[i] && !known[i]) return UINT64_MAX;
+
+		bits += count[i] * len[i];
+	}
+
+	return bits;
+}
+
+// no fresh table can do better than the entropy plus 16 bits per table entry
+static double bound(const std::size_t *count, std::size_t n) {
+
+	double bits = 0.0;
+
+	for(std::size_t i = 0u; i < 256u; ++i) {
+		if(count[i]) bits += count[i] * std::log2(static_cast<double>(n) / count[i]) + 16.0;
+	}
+
+	return bits;
+}
+
+static bool cheaper(uint64_t reuse, double fresh) {
+	return reuse != UINT64_MAX && reuse * 100.0 <= fresh * (100u + REUSE_SLACK);
+}
+
+static void writesegment(std::ostream &out, const HUFFMAN::character_type *b,
+	const HUFFMAN::character_type *e, const HUFFMAN::DICT &dict, bool reuse) {
+
+	std::vector<uint8_t> enc;
+
+	const uint64_t bits = huffman::bits::kernel().pack(reinterpret_cast<const uint8_t *>(b),
+		e - b, huffman::bits::symbol_codes(dict), enc);
+
+	huffman::huffwritetable(out, bits, reuse ? HUFFMAN::DICT() : dict);
+	out.write(reinterpret_cast<const char *>(enc.data()), enc.size());
+}
 
-	header.dict_entries = huff.dictionary().size();
-	header.dict_entry_size = 16u + ((huff.tree()->height() % 8u) ?
-		huff.tree()->height() + (8u - huff.tree()->height() % 8u) :
-		huff.tree()->height());
-	header.bit_length = enc.size();
+// writes [b, e) in segments of block bytes (0: a single one), each of them keeping
+// the table prev of its predecessor unless a fresh one pays off
+static void encode(std::ostream &out, const HUFFMAN::character_type *b,
+	const HUFFMAN::character_type *e, std::size_t block, HUFFMAN::DICT &prev) {
 
-	std::cout.write(reinterpret_cast<char *>(&header), sizeof(huffman::HEADER));
+	while(b != e) {
 
-	for(const auto &e : huff.dictionary()) {
+		const HUFFMAN::character_type *be =
+			block && static_cast<std::size_t>(e - b) > block ? b + block : e;
 
-		std::cout.put(e.second);
+		std::size_t count[256] = {};
 
-		uint8_t  cl = e.first.length;
-		uint64_t cc = e.first.bcode;
+		for(auto p = b; p != be; ++p) ++count[static_cast<uint8_t>(*p)];
 
-		std::cout.write(reinterpret_cast<char *>(&cl), sizeof(uint8_t));
+		const uint64_t reuse = prev.empty() ? UINT64_MAX : cost(count, prev);
 
-		if(header.dict_entry_size < 25u) {
-			std::cout.write(reinterpret_cast<char *>(&cc), sizeof(uint8_t));
-		} else if(header.dict_entry_size < 33u) {
-			std::cout.write(reinterpret_cast<char *>(&cc), sizeof(uint16_t));
-		} else if(header.dict_entry_size < 49u) {
-			std::cout.write(reinterpret_cast<char *>(&cc), sizeof(uint32_t));
+		// skip building a tree if even the best one would not win
+		if(cheaper(reuse, bound(count, be - b))) {
+			writesegment(out, b, be, prev, true);
 		} else {
-			std::cout.write(reinterpret_cast<char *>(&cc), sizeof(uint64_t));
+
+			const HUFFMAN huff(huffman::huffbuild(b, be, true));
+			const uint64_t fresh = cost(count, huff.dictionary()) +
+				huff.dictionary().size() * huffman::huffentrysize(huff.dictionary());
+
+			if(cheaper(reuse, fresh)) {
+				writesegment(out, b, be, prev, true);
+			} else {
+				writesegment(out, b, be, huff.dictionary(), false);
+				prev = huff.dictionary();
+			}
 		}
+
+		b = be;
 	}
+}
 
-	uint8_t     c = 0u;
-	std::size_t b = 0u;
+static bool append(const char *archive, const HUFFMAN::CSEQ &source, std::size_t block) {
 
-	for(auto i : enc) {
+	std::fstream f(archive, std::ios::in|std::ios::out|std::ios::binary);
 
-		if(i) c |= 1u << b;
+	if(!f) return false;
 
-		++b;
+	f.seekg(0, std::ios::end);
+
+	const std::streamoff size = f.tellg();
+	std::streamoff end = 0;
+
+	huffman::HEADER header;
+	HUFFMAN::DICT d, last;
 
-		if(b > 7u) {
+	f.seekg(0, std::ios::beg);
 
-			std::cout.put(c);
+	// find the end of the last segment and the table in effect there
+	while(end < size) {
 
-			b = 0u;
-			c = 0u;
+		if(!huffman::huffreadtable(f, header, d)) return false;
+
+		if(header.version == HUFFVER_SINGLE && end) return false;
+
+		if(header.dict_entries) last.swap(d);
+
+		const uint64_t n = huffman::huffdatasize(header);
+
+		end = f.tellg();
+
+		if(end < 0 || n > static_cast<uint64_t>(size - end)) return false;
+
+		end += n;
+		f.seekg(end);
+
+		// a file of the previous version may end in a padding byte, which gets overwritten
+		if(header.version == HUFFVER_SINGLE) {
+
+			if(size - end > 1) return false;
+
+			break;
 		}
 	}
 
-	if(b < 8u) std::cout.put(c);
+	if(!end) return false;
+
+	// the file is now one of segments
+	const uint32_t version = HUFFVER;
+
+	f.clear();
+	f.seekp(offsetof(huffman::HEADER, version));
+	f.write(reinterpret_cast<const char *>(&version), sizeof(version));
+	f.seekp(end);
+
+	encode(f, source.data(), source.data() + source.size(), block, last);
+
+	f.flush();
+
+	return !!f;
+}
+
+int main(int argc, char **argv) {
+
+	const char *fname = "", *archive = 0L;
+	std::size_t block = 0u;
+
+	for(int i = 1; i < argc; ++i) {
+		if(!std::strcmp(argv[i], "--append") && i + 1 < argc) {
+			archive = argv[++i];
+		} else if(!std::strcmp(argv[i], "--block") && i + 1 < argc) {
+			block = std::strtoul(argv[++i], 0L, 10);
+		} else {
+			fname = argv[i];
+		}
+	}
+
+	HUFFMAN::CSEQ source;
+
+	huffman::huffload(source, fname, *fname && *fname != '-');
+
+	if(archive) return append(archive, source, block) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	HUFFMAN::DICT prev;
+
+	if(source.empty()) {
+		writesegment(std::cout, source.data(), source.data(), prev, false);
+	} else {
+		encode(std::cout, source.data(), source.data() + source.size(), block, prev);
+	}
 
 	std::cout.flush();
 
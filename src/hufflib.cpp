@@ -19,6 +19,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
 
 #include "hufflib.h"
 
@@ -33,10 +34,12 @@ typedef float PROBABILITY;
 
 template class huffman::huffman<char, PROBABILITY, std::vector<unsigned char>>;
 
-HUFFMAN huffman::huffread(HUFFMAN::CSEQ &source, const std::string &fname, bool isFile,
+// segment data is read in chunks, so that a corrupt bit length cannot exhaust the memory
+#define CHUNK 65536u
+
+void huffman::huffload(HUFFMAN::CSEQ &source, const std::string &fname, bool isFile,
 	std::size_t max) {
 
-	HUFFMAN::ALPHABET alpha;
 	std::istream *in;
 
 	if(isFile) {
@@ -45,12 +48,10 @@ HUFFMAN huffman::huffread(HUFFMAN::CSEQ &source, const std::string &fname, bool
 		in = &std::cin;
 	}
 
-	std::unordered_map<char, std::size_t> m;
 	std::size_t ms = 0u;
 	char i;
 
 	while(!in->read(&i, 1).eof()) {
-		++m[i];
 
 		if(max && ms < max) {
 			source.emplace_back(i);
@@ -62,6 +63,29 @@ HUFFMAN huffman::huffread(HUFFMAN::CSEQ &source, const std::string &fname, bool
 	if(isFile) {
 		delete in;
 	}
+}
+
+HUFFMAN huffman::huffread(HUFFMAN::CSEQ &source, const std::string &fname, bool isFile,
+	std::size_t max) {
+
+	const std::size_t start = source.size();
+
+	huffload(source, fname, isFile, max);
+
+	return huffbuild(source.data() + start, source.data() + source.size());
+}
+
+HUFFMAN huffman::huffbuild(const HUFFMAN::character_type *b, const HUFFMAN::character_type *e,
+	bool pad) {
+
+	HUFFMAN::ALPHABET alpha;
+
+	std::unordered_map<char, std::size_t> m;
+	const std::size_t ms = e - b;
+
+	for(auto i = b; i != e; ++i) ++m[*i];
+
+	if(!ms) return HUFFMAN(alpha);
 
 #ifdef HAVE_RATIONAL_H
 	const PROBABILITY pf(1ul, ms);
@@ -73,5 +97,115 @@ HUFFMAN huffman::huffread(HUFFMAN::CSEQ &source, const std::string &fname, bool
 		alpha.emplace_back(HUFFMAN::ALPHABET_ENTRY(mi.first, pf * PROBABILITY(mi.second)));
 	}
 
+	if(pad && m.size() == 1u) {
+		alpha.emplace_back(HUFFMAN::ALPHABET_ENTRY(static_cast<char>(m.begin()->first + 1),
+			PROBABILITY(0u)));
+	}
+
 	return HUFFMAN(alpha);
 }
+
+uint32_t huffman::huffentrysize(const HUFFMAN::DICT &dict) {
+
+	uint32_t h = 0u;
+
+	for(const auto &e : dict) h = std::max<uint32_t>(h, e.first.length);
+
+	return 16u + ((h % 8u) ? h + (8u - h % 8u) : h);
+}
+
+void huffman::huffwritetable(std::ostream &out, uint64_t bit_length, const HUFFMAN::DICT &dict) {
+
+	HEADER header;
+
+	header.dict_entries = dict.size();
+	header.dict_entry_size = dict.empty() ? 0u : huffentrysize(dict);
+	header.bit_length = bit_length;
+
+	out.write(reinterpret_cast<char *>(&header), sizeof(HEADER));
+
+	for(const auto &e : dict) {
+
+		out.put(e.second);
+
+		uint8_t  cl = e.first.length;
+		uint64_t cc = e.first.bcode;
+
+		out.write(reinterpret_cast<char *>(&cl), sizeof(uint8_t));
+
+		if(header.dict_entry_size < 25u) {
+			out.write(reinterpret_cast<char *>(&cc), sizeof(uint8_t));
+		} else if(header.dict_entry_size < 33u) {
+			out.write(reinterpret_cast<char *>(&cc), sizeof(uint16_t));
+		} else if(header.dict_entry_size < 49u) {
+			out.write(reinterpret_cast<char *>(&cc), sizeof(uint32_t));
+		} else {
+			out.write(reinterpret_cast<char *>(&cc), sizeof(uint64_t));
+		}
+	}
+}
+
+bool huffman::huffreadtable(std::istream &in, HEADER &header, HUFFMAN::DICT &dict) {
+
+	const HEADER ref;
+
+	in.read(reinterpret_cast<char *>(&header), sizeof(HEADER));
+
+	if(static_cast<std::size_t>(in.gcount()) != sizeof(HEADER) ||
+		std::memcmp(header.magic, ref.magic, sizeof(ref.magic)) ||
+		(header.version != HUFFVER && header.version != HUFFVER_SINGLE)) return false;
+
+	// there are no more than 256 symbols
+	if(header.dict_entries > 256u) return false;
+
+	dict.clear();
+
+	for(uint32_t i = 0u; i < header.dict_entries && in; ++i) {
+
+		uint8_t  cl = 0u;
+		uint8_t  ch = 0u;
+		uint64_t co = 0u;
+
+		in.read(reinterpret_cast<char *>(&ch), sizeof(uint8_t));
+		in.read(reinterpret_cast<char *>(&cl), sizeof(uint8_t));
+
+		if(header.dict_entry_size < 25u) {
+			in.read(reinterpret_cast<char *>(&co), sizeof(uint8_t));
+		} else if(header.dict_entry_size < 33u) {
+			in.read(reinterpret_cast<char *>(&co), sizeof(uint16_t));
+		} else if(header.dict_entry_size < 49u) {
+			in.read(reinterpret_cast<char *>(&co), sizeof(uint32_t));
+		} else {
+			in.read(reinterpret_cast<char *>(&co), sizeof(uint64_t));
+		}
+
+		// codes longer than 64 bits or with bits beyond their length are corrupt
+		if(cl > 64u || (cl < 64u && (co >> cl))) return false;
+
+		dict[HUFFMAN::DICT_KEY {cl, co}] = static_cast<HUFFMAN::character_type>(ch);
+	}
+
+	return !!in;
+}
+
+uint64_t huffman::huffdatasize(const HEADER &header) {
+	return header.bit_length / 8u + (header.bit_length % 8u ? 1u : 0u);
+}
+
+bool huffman::huffreaddata(std::istream &in, const HEADER &header, std::vector<char> &data) {
+
+	const uint64_t n = huffdatasize(header);
+
+	data.clear();
+
+	while(data.size() < n && in) {
+
+		const std::size_t o = data.size();
+
+		data.resize(o + std::min<uint64_t>(n - o, CHUNK));
+		in.read(data.data() + o, data.size() - o);
+		data.resize(o + static_cast<std::size_t>(in.gcount()));
+	}
+
+	return data.size() == n;
+}
@@ -28,6 +28,9 @@
 #include <rational/rational.h>
 #endif
 
+#include <istream>
+#include <ostream>
+
 #include "huffman.h"
 
 #ifdef HAVE_RATIONAL_H
@@ -45,7 +48,10 @@ typedef huffman::huffman<char, PROBABILITY, std::vector<uint_fast8_t>> HUFFMAN;
 
 namespace huffman {
 
-#define HUFFVER 0x20180214 // new version: today (2018-02-14)
+#define HUFFVER 0x20261019 // new version: today (2026-10-19)
+
+// files of this version hold a single segment, possibly followed by a padding byte
+#define HUFFVER_SINGLE 0x20180214
 
 typedef struct {
 	const uint8_t magic[4] = { 'H', 'u', 'F', 'f' }; // "HuFf"
@@ -55,9 +61,30 @@ typedef struct {
 	uint64_t bit_length = 0u;
 } HEADER;
 
+void huffload(HUFFMAN::CSEQ &source, const std::string &fname, bool isFile,
+	std::size_t max = 0u);
+
 HUFFMAN huffread(HUFFMAN::CSEQ &source, const std::string &fname, bool isFile,
 	std::size_t max = 0u);
 
+// with pad a single symbol gets a zero probability companion, as it needs a code of one bit
+HUFFMAN huffbuild(const HUFFMAN::character_type *b, const HUFFMAN::character_type *e,
+	bool pad = false);
+
+// size of a serialized dictionary entry in bits
+uint32_t huffentrysize(const HUFFMAN::DICT &dict);
+
+// a segment without dictionary entries reuses the table of the previous segment
+void huffwritetable(std::ostream &out, uint64_t bit_length, const HUFFMAN::DICT &dict);
+
+bool huffreadtable(std::istream &in, HEADER &header, HUFFMAN::DICT &dict);
+
+// number of data bytes of a segment, (bit_length + 7) / 8
+uint64_t huffdatasize(const HEADER &header);
+
+// reads the data bytes of a segment, fails if the stream ends before
+bool huffreaddata(std::istream &in, const HEADER &header, std::vector<char> &data);
+
 }
 
 #endif /* _HUFFLIB_H */
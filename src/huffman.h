@@ -21,22 +21,29 @@
 #define _HUFFMAN_H
 
 #include <unordered_map>
+#include <type_traits>
 #include <algorithm>
+#include <memory>
 #include <queue>
 #include <set>
 
 namespace huffman {
 
-template<class CharType, class PropType = double, class BitSeq = std::vector<bool>>
+template<class CharType, class PropType = double, class BitSeq = std::vector<bool>,
+	class Alloc = std::allocator<CharType>>
 class huffman {
 
 	huffman& operator=(const huffman&);
 
+	template<class T>
+	using rebind_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
 public:
 	typedef CharType character_type;
 	typedef PropType probability_type;
 	typedef BitSeq bitsequence_type;
-	typedef std::vector<character_type> CSEQ;
+	typedef Alloc allocator_type;
+	typedef std::vector<character_type, rebind_alloc<character_type>> CSEQ;
 	typedef bitsequence_type CODE;
 
 	typedef class _alphabet_entry {
@@ -59,7 +66,7 @@ public:
 		const probability_type m_probability;
 	} ALPHABET_ENTRY;
 
-	typedef std::vector<ALPHABET_ENTRY> ALPHABET;
+	typedef std::vector<ALPHABET_ENTRY, rebind_alloc<ALPHABET_ENTRY>> ALPHABET;
 	typedef typename ALPHABET::value_type value_type;
 
 private:
@@ -76,11 +83,6 @@ private:
 		_tree_node(const probability_type& p, const character_type &c) : m_probability(p),
 			m_name(c), m_leaf(true), m_height(0u), m_left(0L), m_right(0L) {}
 
-		explicit _tree_node(const _tree_node *o) : m_probability(o->m_probability),
-			m_name(o->m_name), m_leaf(o->m_leaf), m_height(o->m_height),
-			m_left(o->m_left ? new _tree_node(o->m_right) : 0L),
-			m_right(o->m_right ? new _tree_node(o->m_right) : 0L) {}
-
 		const probability_type &probability() const {
 			return m_probability;
 		}
@@ -138,15 +140,19 @@ public:
 
 	} DICT_KEY;
 
-	typedef std::unordered_map<DICT_KEY, character_type, DICT_KEY_HASH> DICT;
+	typedef std::unordered_map<DICT_KEY, character_type, DICT_KEY_HASH, std::equal_to<DICT_KEY>,
+		rebind_alloc<std::pair<const DICT_KEY, character_type>>> DICT;
 	typedef _tree_node TREE;
 
-	huffman(const huffman &o) : m_tree(new TREE(o.m_tree)), m_dictionary(o.m_dictionary) {}
+	huffman(const huffman &o)
+		: m_alloc(std::allocator_traits<Alloc>::select_on_container_copy_construction(o.m_alloc)),
+		m_tree(copy_tree(o.m_tree)), m_dictionary(o.m_dictionary, m_alloc) {}
 
-	explicit huffman(const DICT &d) : m_tree(0l), m_dictionary(d) {}
+	explicit huffman(const DICT &d, const allocator_type &al = allocator_type()) : m_alloc(al),
+		m_tree(0l), m_dictionary(d, al) {}
 
-	explicit huffman(const ALPHABET &a) : m_tree(build_tree(a)),
-		m_dictionary(build_dictionary(a)) {}
+	explicit huffman(const ALPHABET &a, const allocator_type &al = allocator_type())
+		: m_alloc(al), m_tree(build_tree(a)), m_dictionary(build_dictionary(a)) {}
 
 	~huffman() {
 		delete_tree(m_tree);
@@ -155,11 +161,11 @@ public:
 	template<class IIter>
 	CODE encode(IIter b, IIter e) const {
 
-		CODE code;
+		CODE code(make_code());
 
 		for(auto it(b); it != e; ++it) {
 
-			CODE pcode;
+			CODE pcode(make_code());
 
 			if(lookup(*it, pcode, m_tree)) {
 				code.insert(std::end(code), std::begin(pcode), std::end(pcode));
@@ -172,21 +178,24 @@ public:
 	template<class IIter>
 	CSEQ decode(IIter b, IIter e, uint64_t len = 0u) const {
 
-		CSEQ n;
+		CSEQ n(m_alloc);
 
 		if(!m_tree) {
 
-			std::set<typename DICT::value_type> dv(std::begin(m_dictionary),
-				std::end(m_dictionary));
+			const std::set<typename DICT::value_type, std::less<typename DICT::value_type>,
+				rebind_alloc<typename DICT::value_type>> dv(std::begin(m_dictionary),
+					std::end(m_dictionary), std::less<typename DICT::value_type>(), m_alloc);
 
 			for(auto it(b); it < e;) {
 
+				const auto pos(it);
+
 				for(const auto &di : dv) {
 
 					uint64_t ch = 0u;
 
 					for(uint8_t ci = 0; ci < di.first.length; ++ci) {
-						if((it + ci) < e && *(it + ci)) ch |= 1u << ci;
+						if((it + ci) < e && *(it + ci)) ch |= UINT64_C(1) << ci;
 					}
 
 					if(ch == di.first.bcode) {
@@ -196,7 +205,8 @@ public:
 					}
 				}
 
-				if(static_cast<uint64_t>(std::distance(b, it)) >= len) break;
+				// no (or an empty) code matched
+				if(it == pos || static_cast<uint64_t>(std::distance(b, it)) >= len) break;
 			}
 
 		} else {
@@ -227,13 +237,66 @@ public:
 		return m_tree;
 	}
 
+	allocator_type get_allocator() const {
+		return m_alloc;
+	}
+
 private:
+	typedef rebind_alloc<TREE_NODE> NODE_ALLOC;
+	typedef std::allocator_traits<NODE_ALLOC> NODE_TRAITS;
+
+	template<class... Args>
+	TREE_NODE *new_node(Args&&... args) const {
+
+		NODE_ALLOC na(m_alloc);
+		TREE_NODE *n = NODE_TRAITS::allocate(na, 1u);
+
+		try {
+			NODE_TRAITS::construct(na, n, std::forward<Args>(args)...);
+		} catch(...) {
+			NODE_TRAITS::deallocate(na, n, 1u);
+			throw;
+		}
+
+		return n;
+	}
+
+	TREE *copy_tree(const TREE *n) const {
+
+		if(!n) return 0L;
+
+		if(n->leaf()) return new_node(n->probability(), n->name());
+
+		return new_node(n->probability(), copy_tree(n->left()), copy_tree(n->right()),
+			n->height());
+	}
+
 	void delete_tree(_tree_node *n) const {
 
 		if(n && n->left()) delete_tree(n->left());
 		if(n && n->right()) delete_tree(n->right());
 
-		delete n;
+		if(n) {
+
+			NODE_ALLOC na(m_alloc);
+
+			NODE_TRAITS::destroy(na, n);
+			NODE_TRAITS::deallocate(na, n, 1u);
+		}
+	}
+
+	// passes our allocator on to CODE, if it is an allocator aware container
+	// (templates, so that explicit instantiations do not compile the unused branch)
+	template<class C = CODE>
+	typename std::enable_if<std::is_constructible<C, const allocator_type &>::value, C>::type
+	make_code() const {
+		return C(m_alloc);
+	}
+
+	template<class C = CODE>
+	typename std::enable_if<!std::is_constructible<C, const allocator_type &>::value, C>::type
+	make_code() const {
+		return C();
 	}
 
 	bool lookup(const character_type& c, CODE &code, _tree_node *n) const {
@@ -261,11 +324,11 @@ private:
 
 	DICT build_dictionary(const ALPHABET& a) const {
 
-		DICT d;
+		DICT d(0u, DICT_KEY_HASH(), std::equal_to<DICT_KEY>(), m_alloc);
 
 		for(const ALPHABET_ENTRY &c : a) {
 
-			CODE code;
+			CODE code(make_code());
 
 			if(lookup(c.character(), code, m_tree)) {
 
@@ -273,7 +336,7 @@ private:
 				uint8_t bit = 0u;
 
 				for(const auto &i : code) {
-					if(i) cc |= 1u << bit;
+					if(i) cc |= UINT64_C(1) << bit;
 					++bit;
 				}
 
@@ -291,14 +354,15 @@ private:
 		}
 	};
 
-	typedef std::priority_queue<TREE_NODE *, std::vector<TREE_NODE *>, _node_cmp> PQ;
+	typedef std::vector<TREE_NODE *, rebind_alloc<TREE_NODE *>> PQ_CONTAINER;
+	typedef std::priority_queue<TREE_NODE *, PQ_CONTAINER, _node_cmp> PQ;
 
 	TREE *build_tree(const ALPHABET &n) const {
 
-		PQ pq;
+		PQ pq { _node_cmp(), PQ_CONTAINER(m_alloc) };
 
 		for(const ALPHABET_ENTRY &a : n) {
-			pq.push(new TREE_NODE(a.probability(), a.character()));
+			pq.push(new_node(a.probability(), a.character()));
 		}
 
 		while(pq.size() > 1u) {
@@ -311,14 +375,15 @@ private:
 			min[1] = pq.top();
 			pq.pop();
 
-			pq.push(new TREE_NODE(min[0]->probability() + min[1]->probability(),
+			pq.push(new_node(min[0]->probability() + min[1]->probability(),
 				min[0], min[1], std::max(min[0]->height(), min[1]->height()) + 1u));
 		}
 
-		return pq.top();
+		return pq.empty() ? 0L : pq.top();
 	}
 
 private:
+	const allocator_type m_alloc;
 	TREE * const m_tree;
 	DICT   m_dictionary;
 };
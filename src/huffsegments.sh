@@ -0,0 +1,104 @@
+#!/bin/sh
+#
+# Copyright 2018 by Heiko Schäfer <heiko@rangun.de>
+#
+# This file is part of huffman.
+#
+# huffman is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as
+# published by the Free Software Foundation, either version 3 of
+# the License, or (at your option) any later version.
+#
+# huffman is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with huffman.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# round trips through huffenc and huffdec for the segment format
+
+srcdir=${srcdir:-.}
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+failed=0
+
+fail() {
+	echo "FAILED: $*" >&2
+	failed=1
+}
+
+# roundtrip <input> <label> [huffenc options]
+roundtrip() {
+
+	in=$1
+	what=$2
+	shift 2
+
+	./huffenc "$@" "$in" > "$tmp/enc" || fail "$what: huffenc"
+	./huffdec < "$tmp/enc" > "$tmp/dec" || fail "$what: huffdec"
+	cmp -s "$in" "$tmp/dec" || fail "$what: round trip"
+}
+
+cat "$srcdir"/*.cpp "$srcdir"/*.h > "$tmp/text"
+printf 'x' > "$tmp/byte"
+printf 'aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa' > "$tmp/single"
+: > "$tmp/empty"
+
+for k in generic bmi2 avx2; do
+
+	HUFFMAN_KERNEL=$k
+	export HUFFMAN_KERNEL
+
+	for f in text byte single empty; do
+
+		roundtrip "$tmp/$f" "$k $f"
+
+		# 1 byte blocks are all of a single symbol and mostly reuse the previous table
+		for b in 1 7 4096; do
+			roundtrip "$tmp/$f" "$k $f --block $b" --block $b
+		done
+	done
+done
+
+# appending the same input again reuses the table, so it adds less than a fresh file
+./huffenc "$tmp/text" > "$tmp/app"
+fresh=$(wc -c < "$tmp/app")
+
+./huffenc --append "$tmp/app" "$tmp/text" || fail "append: huffenc"
+cat "$tmp/text" "$tmp/text" > "$tmp/twice"
+./huffdec < "$tmp/app" | cmp -s "$tmp/twice" - || fail "append: round trip"
+test $(($(wc -c < "$tmp/app") - fresh)) -lt $fresh || fail "append: table not reused"
+
+# a file of the previous version: a single segment of 8 bits followed by a padding byte
+printf 'abababab' > "$tmp/ab"
+./huffenc "$tmp/ab" > "$tmp/old"
+printf '\024\002\030\040' | dd of="$tmp/old" bs=1 seek=4 conv=notrunc 2> /dev/null
+printf '\000' >> "$tmp/old"
+
+./huffdec < "$tmp/old" | cmp -s "$tmp/ab" - || fail "previous version: huffdec"
+./huffenc --append "$tmp/old" "$tmp/text" || fail "previous version: append"
+cat "$tmp/ab" "$tmp/text" > "$tmp/both"
+./huffdec < "$tmp/old" | cmp -s "$tmp/both" - || fail "previous version: round trip"
+
+# a corrupt second segment is neither decoded nor appended to
+dd if="$tmp/text" of="$tmp/first" bs=4096 count=1 2> /dev/null
+./huffenc --block 4096 "$tmp/text" > "$tmp/bad"
+printf 'X' | dd of="$tmp/bad" bs=1 seek=$(./huffenc "$tmp/first" | wc -c) conv=notrunc 2> /dev/null
+cp "$tmp/bad" "$tmp/bad.orig"
+
+! ./huffdec < "$tmp/bad" > /dev/null || fail "corrupt: huffdec"
+! ./huffenc --append "$tmp/bad" "$tmp/byte" || fail "corrupt: append"
+cmp -s "$tmp/bad" "$tmp/bad.orig" || fail "corrupt: append changed the file"
+
+# only files of the previous version may have a byte behind their last segment
+./huffenc "$tmp/text" > "$tmp/tail"
+printf '\000' >> "$tmp/tail"
+
+! ./huffdec < "$tmp/tail" > /dev/null || fail "trailing byte: huffdec"
+! ./huffenc --append "$tmp/tail" "$tmp/byte" || fail "trailing byte: append"
+
+exit $failed